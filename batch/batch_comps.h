@@ -0,0 +1,10 @@
+#ifndef BATCH_COMPS_H
+#define BATCH_COMPS_H
+
+// loaders of the .comp components, generated by comp2c.py (see compile.sh)
+
+int sim_fork_light_barrier_batch_load(const char *names, int count);
+int sim_workpiece_quad_batch_load(const char *names, int count);
+int sim_workpiece_ring_batch_load(const char *names, int count);
+
+#endif
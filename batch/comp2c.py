@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+# Translates a .comp file into C for the batch runner, the same way halcompile
+# does for a real LinuxCNC module, but against the stub HAL of this directory.
+# Only the subset of the .comp syntax used in this repository is supported:
+# pin, param, variable, function (fp/nofp) and FUNCTION(name) bodies.
+#
+# usage: comp2c.py file.comp output.c
+
+import os
+import re
+import sys
+
+HAL_TYPES = {"bit": "hal_bit_t", "float": "hal_float_t", "s32": "hal_s32_t", "u32": "hal_u32_t"}
+PIN_DIRS = {"in": "HAL_IN", "out": "HAL_OUT", "io": "HAL_IO"}
+PARAM_DIRS = {"r": "HAL_RO", "rw": "HAL_RW"}
+
+RE_PIN = re.compile(r'^pin\s+(in|out|io)\s+(bit|float|s32|u32)\s+([\w#.-]+)\s*(?:\[(\d+)\])?\s*(?:=\s*([^"\s]+))?\s*(?:"[^"]*")?$')
+RE_PARAM = re.compile(r'^param\s+(rw|r)\s+(bit|float|s32|u32)\s+([\w#.-]+)\s*(?:\[(\d+)\])?\s*(?:=\s*([^"\s]+))?\s*(?:"[^"]*")?$')
+RE_VARIABLE = re.compile(r'^variable\s+(.+?)\s*\b(\w+)\s*(?:\[(\d+)\])?\s*(?:=\s*(.+))?$')
+RE_FUNCTION = re.compile(r'^function\s+(\w+)\s*(fp|nofp)?')
+RE_COMPONENT = re.compile(r'^component\s+(\w+)')
+
+
+def to_c(name):
+    return re.sub(r'[-._]*#+', '', name).replace('-', '_').replace('.', '_')
+
+
+def to_hal(name, index=None):
+    name = name.replace('_', '-')
+    if index is not None:
+        name = re.sub(r'#+', lambda m: '%0*d' % (len(m.group(0)), index), name)
+    return name
+
+
+def parse(text):
+    header, code = text.split('\n;;\n', 1)
+    # the line where the C code starts, for #line
+    code_line = header.count('\n') + 3
+    header = re.sub(r'"""(.|\n)*?"""', '""', header)
+
+    comp = {"name": None, "pins": [], "params": [], "variables": [], "functions": []}
+    for stmt in re.findall(r'((?:[^;"]|"[^"]*")*);', header):
+        stmt = ' '.join(stmt.split())
+        m = RE_COMPONENT.match(stmt)
+        if m:
+            comp["name"] = m.group(1)
+            continue
+        m = RE_PIN.match(stmt)
+        if m:
+            comp["pins"].append(m.groups())
+            continue
+        m = RE_PARAM.match(stmt)
+        if m:
+            comp["params"].append(m.groups())
+            continue
+        m = RE_FUNCTION.match(stmt)
+        if m:
+            comp["functions"].append(m.group(1))
+            continue
+        m = RE_VARIABLE.match(stmt)
+        if m:
+            comp["variables"].append(m.groups())
+            continue
+        if stmt.split(' ')[0] in ("description", "author", "license", "option", "see_also", "notes", ""):
+            continue
+        sys.exit("%s: unsupported statement: %s" % (sys.argv[1], stmt))
+    return comp, code, code_line
+
+
+def generate(comp, code, code_line, source):
+    name = comp["name"]
+    out = []
+    w = out.append
+    w("// generated by comp2c.py from %s, do not edit" % source)
+    w('#include <stdio.h>')
+    w('#include <string.h>')
+    w('#include "rtapi.h"')
+    w('#include "hal.h"')
+    w('#include "batch_comps.h"')
+    w('')
+    w('static int comp_id;')
+    w('')
+    w('struct __comp_state')
+    w('{')
+    for _, typ, pname, size, _ in comp["pins"]:
+        w('\t%s *%s%s;' % (HAL_TYPES[typ], to_c(pname), '[%s]' % size if size else ''))
+    for _, typ, pname, size, _ in comp["params"]:
+        w('\t%s %s%s;' % (HAL_TYPES[typ], to_c(pname), '[%s]' % size if size else ''))
+    for ctype, vname, size, _ in comp["variables"]:
+        w('\t%s %s%s;' % (ctype, vname, '[%s]' % size if size else ''))
+    w('};')
+    w('')
+
+    macros = []
+    for direction, _, pname, size, _ in comp["pins"]:
+        c = to_c(pname)
+        # like halcompile, input pins can not be assigned
+        deref = '0+*' if direction == 'in' else '*'
+        if size:
+            macros.append((c + '(i)', '(%s(__comp_inst->%s[i]))' % (deref, c)))
+        else:
+            macros.append((c, '(%s__comp_inst->%s)' % (deref, c)))
+    for _, _, pname, size, _ in comp["params"]:
+        c = to_c(pname)
+        if size:
+            macros.append((c + '(i)', '(__comp_inst->%s[i])' % c))
+        else:
+            macros.append((c, '(__comp_inst->%s)' % c))
+    for _, vname, _, _ in comp["variables"]:
+        macros.append((vname, '(__comp_inst->%s)' % vname))
+    for m, v in macros:
+        w('#define %s %s' % (m, v))
+    w('#define FUNCTION(name) static void name(struct __comp_state *__comp_inst, long period)')
+    w('#define fperiod (period * 1e-9)')
+    for f in comp["functions"]:
+        w('FUNCTION(%s);' % f)
+    w('')
+    w('#line %d "%s"' % (code_line, source))
+    w(code)
+    w('')
+    for m, _ in macros:
+        w('#undef %s' % m.split('(')[0])
+    w('#undef FUNCTION')
+    w('#undef fperiod')
+    w('')
+
+    for f in comp["functions"]:
+        w('static void funct_%s(void *arg, long period)' % f)
+        w('{')
+        w('\t%s((struct __comp_state *)arg, period);' % f)
+        w('}')
+        w('')
+
+    w('static int export_instance(const char *prefix)')
+    w('{')
+    w('\tchar name[64];')
+    w('\tint r;')
+    w('\tstruct __comp_state *inst = hal_malloc(sizeof(struct __comp_state));')
+    w('\tif (!inst)')
+    w('\t\treturn -ENOMEM;')
+    for direction, typ, pname, size, default in comp["pins"]:
+        c = to_c(pname)
+        if size:
+            w('\tfor (int i = 0; i < %s; i++)' % size)
+            w('\t{')
+            w('\t\tsnprintf(name, sizeof(name), "%%s.%s", prefix, i);' % re.sub(r'#+', lambda m: '%%0%dd' % len(m.group(0)), to_hal(pname)))
+            w('\t\tif ((r = hal_pin_%s_new(name, %s, &inst->%s[i], comp_id)) != 0)' % (typ, PIN_DIRS[direction], c))
+            w('\t\t\treturn r;')
+            if default:
+                w('\t\t*(inst->%s[i]) = %s;' % (c, default))
+            w('\t}')
+        else:
+            w('\tsnprintf(name, sizeof(name), "%%s.%s", prefix);' % to_hal(pname))
+            w('\tif ((r = hal_pin_%s_new(name, %s, &inst->%s, comp_id)) != 0)' % (typ, PIN_DIRS[direction], c))
+            w('\t\treturn r;')
+            if default:
+                w('\t*(inst->%s) = %s;' % (c, default))
+    for direction, typ, pname, size, default in comp["params"]:
+        c = to_c(pname)
+        if size:
+            w('\tfor (int i = 0; i < %s; i++)' % size)
+            w('\t{')
+            w('\t\tsnprintf(name, sizeof(name), "%%s.%s", prefix, i);' % re.sub(r'#+', lambda m: '%%0%dd' % len(m.group(0)), to_hal(pname)))
+            w('\t\tif ((r = hal_param_%s_new(name, %s, &inst->%s[i], comp_id)) != 0)' % (typ, PARAM_DIRS[direction], c))
+            w('\t\t\treturn r;')
+            if default:
+                w('\t\tinst->%s[i] = %s;' % (c, default))
+            w('\t}')
+        else:
+            w('\tsnprintf(name, sizeof(name), "%%s.%s", prefix);' % to_hal(pname))
+            w('\tif ((r = hal_param_%s_new(name, %s, &inst->%s, comp_id)) != 0)' % (typ, PARAM_DIRS[direction], c))
+            w('\t\treturn r;')
+            if default:
+                w('\tinst->%s = %s;' % (c, default))
+    for _, vname, size, default in comp["variables"]:
+        if default and not size:
+            w('\tinst->%s = %s;' % (vname, default))
+    for f in comp["functions"]:
+        if f == '_':
+            w('\tsnprintf(name, sizeof(name), "%s", prefix);')
+        else:
+            w('\tsnprintf(name, sizeof(name), "%%s.%s", prefix);' % to_hal(f))
+        w('\tif ((r = hal_export_funct(name, funct_%s, inst, 1, 0, comp_id)) != 0)' % f)
+        w('\t\treturn r;')
+    w('\treturn 0;')
+    w('}')
+    w('')
+
+    w('// names: comma separated instance names, otherwise count instances %s.N' % to_hal(name))
+    w('int %s_batch_load(const char *names, int count)' % name)
+    w('{')
+    w('\tchar prefix[64];')
+    w('\tint r;')
+    w('\tcomp_id = hal_init("%s");' % name)
+    w('\tif (comp_id < 0)')
+    w('\t\treturn comp_id;')
+    w('\tif (names && *names)')
+    w('\t{')
+    w('\t\tconst char *p = names;')
+    w('\t\twhile (*p)')
+    w('\t\t{')
+    w('\t\t\tsize_t len = strcspn(p, ",");')
+    w('\t\t\tsnprintf(prefix, sizeof(prefix), "%.*s", (int)len, p);')
+    w('\t\t\tif ((r = export_instance(prefix)) != 0)')
+    w('\t\t\t\treturn r;')
+    w('\t\t\tp += len;')
+    w('\t\t\tif (*p == \',\')')
+    w('\t\t\t\tp++;')
+    w('\t\t}')
+    w('\t}')
+    w('\telse')
+    w('\t{')
+    w('\t\tfor (int i = 0; i < count; i++)')
+    w('\t\t{')
+    w('\t\t\tsnprintf(prefix, sizeof(prefix), "%s.%%d", i);' % to_hal(name))
+    w('\t\t\tif ((r = export_instance(prefix)) != 0)')
+    w('\t\t\t\treturn r;')
+    w('\t\t}')
+    w('\t}')
+    w('\treturn hal_ready(comp_id);')
+    w('}')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: comp2c.py file.comp output.c")
+    source = sys.argv[1]
+    with open(source) as f:
+        comp, code, code_line = parse(f.read())
+    if not comp["name"]:
+        sys.exit("%s: no component statement" % source)
+    if os.path.splitext(os.path.basename(source))[0] != comp["name"]:
+        sys.exit("%s: component name does not match the file name" % source)
+    with open(sys.argv[2], 'w') as f:
+        f.write(generate(comp, code, code_line, source))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+# builds the headless batch runner with the stub HAL of this directory,
+# the .comp components are translated to C by comp2c.py instead of halcompile
+set -e
+cd "$(dirname "$0")"
+mkdir -p gen
+for comp in ../sim_fork_light_barrier.comp ../sim_workpiece_quad.comp ../sim_workpiece_ring.comp; do
+    python3 comp2c.py "$comp" "gen/$(basename "$comp" .comp).c"
+done
+gcc -std=gnu99 -O2 -I. -o hal_batch hal_batch.c hal_stub.c ../hm2_eth_mock.c gen/*.c -lm
@@ -0,0 +1,56 @@
+#ifndef BATCH_HAL_H
+#define BATCH_HAL_H
+
+// Minimal stand-in for the LinuxCNC hal.h. Pins, parameters and functions are
+// kept in plain process-local tables (see hal_stub.c) instead of the HAL shared
+// memory, so every batch job runs in its own process without halrun.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+
+typedef volatile bool hal_bit_t;
+typedef volatile double hal_float_t;
+typedef volatile int32_t hal_s32_t;
+typedef volatile uint32_t hal_u32_t;
+
+typedef enum
+{
+	HAL_BIT = 1,
+	HAL_FLOAT = 2,
+	HAL_S32 = 3,
+	HAL_U32 = 4
+} hal_type_t;
+
+typedef enum
+{
+	HAL_DIR_UNSPECIFIED = -1,
+	HAL_IN = 16,
+	HAL_OUT = 32,
+	HAL_IO = (HAL_IN | HAL_OUT)
+} hal_pin_dir_t;
+
+typedef enum
+{
+	HAL_RO = 64,
+	HAL_RW = 192
+} hal_param_dir_t;
+
+int hal_init(const char *name);
+int hal_ready(int comp_id);
+int hal_exit(int comp_id);
+void *hal_malloc(long size);
+
+int hal_pin_bit_new(const char *name, hal_pin_dir_t dir, hal_bit_t **data_ptr_addr, int comp_id);
+int hal_pin_float_new(const char *name, hal_pin_dir_t dir, hal_float_t **data_ptr_addr, int comp_id);
+int hal_pin_s32_new(const char *name, hal_pin_dir_t dir, hal_s32_t **data_ptr_addr, int comp_id);
+int hal_pin_u32_new(const char *name, hal_pin_dir_t dir, hal_u32_t **data_ptr_addr, int comp_id);
+
+int hal_param_bit_new(const char *name, hal_param_dir_t dir, hal_bit_t *data_addr, int comp_id);
+int hal_param_float_new(const char *name, hal_param_dir_t dir, hal_float_t *data_addr, int comp_id);
+int hal_param_s32_new(const char *name, hal_param_dir_t dir, hal_s32_t *data_addr, int comp_id);
+int hal_param_u32_new(const char *name, hal_param_dir_t dir, hal_u32_t *data_addr, int comp_id);
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg, int uses_fp, int reentrant, int comp_id);
+
+#endif
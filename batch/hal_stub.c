@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtapi.h"
+#include "hal.h"
+#include "hal_stub.h"
+
+// Process-local replacement for the HAL shared memory. Each batch job runs in
+// its own process, so no locking and no cleanup is needed here.
+
+typedef union
+{
+	hal_bit_t b;
+	hal_float_t f;
+	hal_s32_t s;
+	hal_u32_t u;
+} hal_stub_data_t;
+
+typedef struct
+{
+	char name[64];
+	char **var;
+} rtapi_mp_t;
+
+// every object is allocated on its own, so pointers stay valid while the table grows
+static hal_stub_obj_t **objects = NULL;
+static int num_objects = 0;
+static int max_objects = 0;
+
+static hal_stub_funct_t **functs = NULL;
+static int num_functs = 0;
+static int max_functs = 0;
+
+static rtapi_mp_t mod_params[16];
+static int num_mod_params = 0;
+
+static int next_comp_id = 1;
+
+void rtapi_mp_string_register(const char *name, char **var)
+{
+	if (num_mod_params >= (int)(sizeof(mod_params) / sizeof(mod_params[0])))
+		return;
+	snprintf(mod_params[num_mod_params].name, sizeof(mod_params[0].name), "%s", name);
+	mod_params[num_mod_params].var = var;
+	num_mod_params++;
+}
+
+int rtapi_mp_string_set(const char *name, const char *value)
+{
+	for (int i = 0; i < num_mod_params; i++)
+	{
+		if (strcmp(mod_params[i].name, name) == 0)
+		{
+			*(mod_params[i].var) = strdup(value);
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+int hal_init(const char *name)
+{
+	return next_comp_id++;
+}
+
+int hal_ready(int comp_id)
+{
+	return 0;
+}
+
+int hal_exit(int comp_id)
+{
+	return 0;
+}
+
+void *hal_malloc(long size)
+{
+	return calloc(1, size > 0 ? size : 1);
+}
+
+static hal_stub_obj_t *add_object(const char *name, hal_stub_kind_t kind, hal_type_t type, int dir)
+{
+	if (hal_stub_find(name))
+	{
+		fprintf(stderr, "HAL: ERROR: duplicate name '%s'\n", name);
+		return NULL;
+	}
+	if (num_objects == max_objects)
+	{
+		int new_max = max_objects ? max_objects * 2 : 256;
+		hal_stub_obj_t **tmp = realloc(objects, new_max * sizeof(hal_stub_obj_t *));
+		if (!tmp)
+			return NULL;
+		objects = tmp;
+		max_objects = new_max;
+	}
+	hal_stub_obj_t *obj = calloc(1, sizeof(hal_stub_obj_t));
+	if (!obj)
+		return NULL;
+	objects[num_objects++] = obj;
+	snprintf(obj->name, sizeof(obj->name), "%s", name);
+	obj->kind = kind;
+	obj->type = type;
+	obj->dir = dir;
+	return obj;
+}
+
+static int pin_new(const char *name, hal_type_t type, hal_pin_dir_t dir, void **data_ptr_addr)
+{
+	hal_stub_obj_t *obj = add_object(name, HAL_STUB_PIN, type, dir);
+	if (!obj)
+		return -EINVAL;
+	// like in HAL an unconnected pin points to its own dummy storage
+	obj->data = hal_malloc(sizeof(hal_stub_data_t));
+	if (!obj->data)
+		return -ENOMEM;
+	obj->data_ptr = data_ptr_addr;
+	*data_ptr_addr = (void *)obj->data;
+	return 0;
+}
+
+static int param_new(const char *name, hal_type_t type, hal_param_dir_t dir, volatile void *data_addr)
+{
+	hal_stub_obj_t *obj = add_object(name, HAL_STUB_PARAM, type, dir);
+	if (!obj)
+		return -EINVAL;
+	obj->data = data_addr;
+	return 0;
+}
+
+int hal_pin_bit_new(const char *name, hal_pin_dir_t dir, hal_bit_t **data_ptr_addr, int comp_id)
+{
+	return pin_new(name, HAL_BIT, dir, (void **)data_ptr_addr);
+}
+
+int hal_pin_float_new(const char *name, hal_pin_dir_t dir, hal_float_t **data_ptr_addr, int comp_id)
+{
+	return pin_new(name, HAL_FLOAT, dir, (void **)data_ptr_addr);
+}
+
+int hal_pin_s32_new(const char *name, hal_pin_dir_t dir, hal_s32_t **data_ptr_addr, int comp_id)
+{
+	return pin_new(name, HAL_S32, dir, (void **)data_ptr_addr);
+}
+
+int hal_pin_u32_new(const char *name, hal_pin_dir_t dir, hal_u32_t **data_ptr_addr, int comp_id)
+{
+	return pin_new(name, HAL_U32, dir, (void **)data_ptr_addr);
+}
+
+int hal_param_bit_new(const char *name, hal_param_dir_t dir, hal_bit_t *data_addr, int comp_id)
+{
+	return param_new(name, HAL_BIT, dir, data_addr);
+}
+
+int hal_param_float_new(const char *name, hal_param_dir_t dir, hal_float_t *data_addr, int comp_id)
+{
+	return param_new(name, HAL_FLOAT, dir, data_addr);
+}
+
+int hal_param_s32_new(const char *name, hal_param_dir_t dir, hal_s32_t *data_addr, int comp_id)
+{
+	return param_new(name, HAL_S32, dir, data_addr);
+}
+
+int hal_param_u32_new(const char *name, hal_param_dir_t dir, hal_u32_t *data_addr, int comp_id)
+{
+	return param_new(name, HAL_U32, dir, data_addr);
+}
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg, int uses_fp, int reentrant, int comp_id)
+{
+	if (hal_stub_find_funct(name))
+		return -EINVAL;
+	if (num_functs == max_functs)
+	{
+		int new_max = max_functs ? max_functs * 2 : 16;
+		hal_stub_funct_t **tmp = realloc(functs, new_max * sizeof(hal_stub_funct_t *));
+		if (!tmp)
+			return -ENOMEM;
+		functs = tmp;
+		max_functs = new_max;
+	}
+	// the threads keep pointers to the functs, so they are allocated on their own as well
+	hal_stub_funct_t *f = calloc(1, sizeof(hal_stub_funct_t));
+	if (!f)
+		return -ENOMEM;
+	functs[num_functs++] = f;
+	snprintf(f->name, sizeof(f->name), "%s", name);
+	f->funct = funct;
+	f->arg = arg;
+	return 0;
+}
+
+hal_stub_obj_t *hal_stub_find(const char *name)
+{
+	for (int i = 0; i < num_objects; i++)
+	{
+		if (strcmp(objects[i]->name, name) == 0)
+			return objects[i];
+	}
+	return NULL;
+}
+
+hal_stub_obj_t *hal_stub_get(int index)
+{
+	return (index >= 0 && index < num_objects) ? objects[index] : NULL;
+}
+
+int hal_stub_count(void)
+{
+	return num_objects;
+}
+
+hal_stub_funct_t *hal_stub_find_funct(const char *name)
+{
+	for (int i = 0; i < num_functs; i++)
+	{
+		if (strcmp(functs[i]->name, name) == 0)
+			return functs[i];
+	}
+	return NULL;
+}
+
+int hal_stub_signal_new(const char *name, hal_type_t type)
+{
+	hal_stub_obj_t *obj = add_object(name, HAL_STUB_SIGNAL, type, 0);
+	if (!obj)
+		return -EINVAL;
+	obj->data = hal_malloc(sizeof(hal_stub_data_t));
+	return obj->data ? 0 : -ENOMEM;
+}
+
+int hal_stub_link(hal_stub_obj_t *pin, hal_stub_obj_t *signal)
+{
+	if (pin->kind != HAL_STUB_PIN || signal->kind != HAL_STUB_SIGNAL || pin->type != signal->type)
+		return -EINVAL;
+	if (pin->linked)
+		return -EBUSY;
+	// same rules as hal_link(): one OUT pin, or any number of I/O pins
+	if (pin->dir == HAL_OUT && (signal->writers > 0 || signal->bidirs > 0))
+		return -EBUSY;
+	if (pin->dir == HAL_IO && signal->writers > 0)
+		return -EBUSY;
+	if (pin->dir == HAL_OUT)
+		signal->writers++;
+	else if (pin->dir == HAL_IO)
+		signal->bidirs++;
+	// the component follows its pointer, so from now on it reads/writes the signal
+	pin->data = signal->data;
+	*(pin->data_ptr) = (void *)signal->data;
+	pin->linked = 1;
+	return 0;
+}
+
+int hal_stub_set(hal_stub_obj_t *obj, const char *value)
+{
+	char *end;
+	switch (obj->type)
+	{
+	case HAL_BIT:
+		if (strcmp(value, "1") == 0 || strcmp(value, "TRUE") == 0 || strcmp(value, "true") == 0)
+			*(hal_bit_t *)obj->data = 1;
+		else if (strcmp(value, "0") == 0 || strcmp(value, "FALSE") == 0 || strcmp(value, "false") == 0)
+			*(hal_bit_t *)obj->data = 0;
+		else
+			return -EINVAL;
+		return 0;
+	case HAL_FLOAT:
+	{
+		double v = strtod(value, &end);
+		if (*end)
+			return -EINVAL;
+		*(hal_float_t *)obj->data = v;
+		return 0;
+	}
+	case HAL_S32:
+	{
+		long v = strtol(value, &end, 0);
+		if (*end)
+			return -EINVAL;
+		*(hal_s32_t *)obj->data = (int32_t)v;
+		return 0;
+	}
+	case HAL_U32:
+	{
+		unsigned long v = strtoul(value, &end, 0);
+		if (*end)
+			return -EINVAL;
+		*(hal_u32_t *)obj->data = (uint32_t)v;
+		return 0;
+	}
+	}
+	return -EINVAL;
+}
+
+void hal_stub_format(const hal_stub_obj_t *obj, char *buf, int size)
+{
+	switch (obj->type)
+	{
+	case HAL_BIT:
+		snprintf(buf, size, "%s", *(hal_bit_t *)obj->data ? "TRUE" : "FALSE");
+		break;
+	case HAL_FLOAT:
+		snprintf(buf, size, "%.7g", *(hal_float_t *)obj->data);
+		break;
+	case HAL_S32:
+		snprintf(buf, size, "%d", (int)*(hal_s32_t *)obj->data);
+		break;
+	case HAL_U32:
+		snprintf(buf, size, "0x%08X", (unsigned)*(hal_u32_t *)obj->data);
+		break;
+	}
+}
+
+const char *hal_stub_type_name(hal_type_t type)
+{
+	switch (type)
+	{
+	case HAL_BIT:
+		return "bit";
+	case HAL_FLOAT:
+		return "float";
+	case HAL_S32:
+		return "s32";
+	case HAL_U32:
+		return "u32";
+	}
+	return "?";
+}
+
+const char *hal_stub_dir_name(const hal_stub_obj_t *obj)
+{
+	if (obj->kind == HAL_STUB_PIN)
+		return obj->dir == HAL_IN ? "IN" : (obj->dir == HAL_OUT ? "OUT" : "I/O");
+	if (obj->kind == HAL_STUB_PARAM)
+		return obj->dir == HAL_RW ? "RW" : "RO";
+	return "";
+}
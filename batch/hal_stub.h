@@ -0,0 +1,50 @@
+#ifndef BATCH_HAL_STUB_H
+#define BATCH_HAL_STUB_H
+
+#include "hal.h"
+
+// Batch runner side of the stub HAL: lookup and access of the objects the
+// component created via hal.h.
+
+typedef enum
+{
+	HAL_STUB_PIN,
+	HAL_STUB_PARAM,
+	HAL_STUB_SIGNAL
+} hal_stub_kind_t;
+
+typedef struct
+{
+	char name[64];
+	hal_stub_kind_t kind;
+	hal_type_t type;
+	int dir;			// hal_pin_dir_t or hal_param_dir_t, 0 for signals
+	volatile void *data; // current value
+	void **data_ptr;	 // pins only: component's pointer, redirected by net
+	int linked;			 // pins only: connected to a signal
+	int writers;		 // signals only: number of linked OUT pins
+	int bidirs;			 // signals only: number of linked I/O pins
+} hal_stub_obj_t;
+
+typedef struct
+{
+	char name[64];
+	void (*funct)(void *, long);
+	void *arg;
+} hal_stub_funct_t;
+
+hal_stub_obj_t *hal_stub_find(const char *name);
+hal_stub_obj_t *hal_stub_get(int index);
+int hal_stub_count(void);
+hal_stub_funct_t *hal_stub_find_funct(const char *name);
+
+int hal_stub_signal_new(const char *name, hal_type_t type);
+int hal_stub_link(hal_stub_obj_t *pin, hal_stub_obj_t *signal);
+int hal_stub_set(hal_stub_obj_t *obj, const char *value);
+void hal_stub_format(const hal_stub_obj_t *obj, char *buf, int size);
+const char *hal_stub_type_name(hal_type_t type);
+const char *hal_stub_dir_name(const hal_stub_obj_t *obj);
+
+int rtapi_mp_string_set(const char *name, const char *value);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef BATCH_RTAPI_H
+#define BATCH_RTAPI_H
+
+// Minimal stand-in for the LinuxCNC rtapi.h, only what hm2_eth_mock.c needs
+// to be built into the headless batch runner (see hal_batch.c).
+// Never put this directory on the include path of halcompile.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define MODULE_AUTHOR(s)
+#define MODULE_DESCRIPTION(s)
+#define MODULE_LICENSE(s)
+
+#define rtapi_print(...) printf(__VA_ARGS__)
+
+// module parameters are registered by name, so the batch runner can set them
+// from a "loadrt" line before rtapi_app_main() is called
+void rtapi_mp_string_register(const char *name, char **var);
+
+#define RTAPI_MP_STRING(var, descr)                                    \
+	static void __attribute__((constructor)) rtapi_mp_register_##var(void) \
+	{                                                                  \
+		rtapi_mp_string_register(#var, &(var));                        \
+	}
+
+#endif
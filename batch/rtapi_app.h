@@ -0,0 +1,9 @@
+#ifndef BATCH_RTAPI_APP_H
+#define BATCH_RTAPI_APP_H
+
+#include "rtapi.h"
+
+int rtapi_app_main(void);
+void rtapi_app_exit(void);
+
+#endif
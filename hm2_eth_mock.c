@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <stdint.h>
 #include "hal_helpers.h"
 
 MODULE_AUTHOR("Peter Ludwig");
@@ -12,7 +14,7 @@ MODULE_LICENSE("GPL");
 
 static int comp_id;
 
-static char *version = "0.8";
+static char *version = "0.10";
 
 // simulating configuration of mesa card
 static char *config = "";
@@ -33,6 +35,20 @@ static hal_u32_t *stepgen_timer_number;
 
 static hal_float_t **field_voltage, **field_voltage_sim;
 
+// test signal added to a -sim input: waveform plus noise
+typedef struct
+{
+	hal_u32_t *waveform; // 0: none, 1: ramp, 2: sine, 3: step
+	hal_float_t *amplitude;
+	hal_float_t *frequency;
+	hal_float_t *noise; // standard deviation
+
+	double phase;
+	uint32_t rng_state;
+} sim_signal_t;
+
+static sim_signal_t *field_voltage_signal;
+
 static char sserial_ports[64] = "";	 // optional capture
 static int sserial_first_digit = -1; // Default to invalid
 
@@ -52,6 +68,7 @@ typedef struct
 {
 	hal_float_t *in;
 	hal_float_t *in_sim;
+	sim_signal_t signal;
 
 } analog_in_t;
 
@@ -95,6 +112,13 @@ typedef struct
 	hal_float_t maxAcceleration;
 	hal_float_t maxVelocity;
 
+	// inputs of the last evaluation, to skip unchanged cycles
+	bool cache_valid;
+	bool last_control_type;
+	double last_pos_cmd;
+	double last_velocity_cmd;
+	double last_position_scale;
+
 } stepgen_t;
 
 typedef struct
@@ -148,6 +172,15 @@ typedef struct
 	spindle_t *spindle;
 	stepgen_t *step_gen;
 	pwm_t *pwm;
+
+	hal_u32_t *stepgen_evaluated;
+	hal_u32_t *stepgen_skipped;
+
+	// ADC of the analog inputs and the field voltage
+	hal_u32_t *adc_bits; // 0: no quantization
+	hal_float_t *adc_full_scale;
+	hal_u32_t *adc_update_ns; // 0: every read
+	long adc_elapsed_ns;
 } card_t;
 
 static card_t *cards = NULL;
@@ -193,6 +226,70 @@ static void parse_config_string(const char *config_str)
 	free(config_copy);
 }
 
+static uint32_t sim_signal_random(sim_signal_t *sig)
+{
+	// xorshift32, cheap enough for every channel in every cycle
+	uint32_t x = sig->rng_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	sig->rng_state = x;
+	return x;
+}
+
+static void sim_signal_init(sim_signal_t *sig, uint32_t seed)
+{
+	sig->phase = 0;
+	sig->rng_state = seed ? seed : 1;
+}
+
+// value to add to the -sim input, advances the waveform by dt [s]
+static double sim_signal_next(sim_signal_t *sig, double dt)
+{
+	double value = 0;
+
+	sig->phase += *(sig->frequency) * dt;
+	sig->phase -= floor(sig->phase);
+
+	switch (*(sig->waveform))
+	{
+	case 1:
+		value = *(sig->amplitude) * sig->phase;
+		break;
+	case 2:
+		value = *(sig->amplitude) * sin(2 * M_PI * sig->phase);
+		break;
+	case 3:
+		value = (sig->phase < 0.5) ? 0 : *(sig->amplitude);
+		break;
+	}
+
+	if (*(sig->noise) > 0)
+	{
+		// sum of 4 uniform values as approximation of a normal distribution
+		double sum = 0;
+		for (int i = 0; i < 4; i++)
+			sum += (double)sim_signal_random(sig) / 4294967295.0 - 0.5;
+		value += *(sig->noise) * sqrt(3.0) * sum;
+	}
+	return value;
+}
+
+static double adc_quantize(const card_t *card, double value)
+{
+	// cards without analog inputs have no ADC parameters
+	if (!card->adc_bits || !card->adc_full_scale)
+		return value;
+	if (*(card->adc_bits) == 0 || *(card->adc_bits) > 31 || *(card->adc_full_scale) <= 0)
+		return value;
+	double lsb = *(card->adc_full_scale) / (double)((1u << *(card->adc_bits)) - 1);
+	if (value < 0)
+		value = 0;
+	if (value > *(card->adc_full_scale))
+		value = *(card->adc_full_scale);
+	return round(value / lsb) * lsb;
+}
+
 // as the physical card has read and write function both are adapted
 // but for simulation only one of them does the simulation job
 static void write(void *arg, long period_nsec) {}
@@ -212,6 +309,25 @@ static void read(void *arg, long period_nsec)
 		for (int i = 0; i < cards[card_index].config.num_stepgens; i++)
 		{
 			stepgen_t *sg = &cards[card_index].step_gen[i];
+
+			// outputs only change with the inputs, or while integrating a velocity
+			if (sg->cache_valid &&
+				*(sg->control_type) == sg->last_control_type &&
+				*(sg->pos_cmd) == sg->last_pos_cmd &&
+				*(sg->velocity_cmd) == sg->last_velocity_cmd &&
+				sg->positionScale == sg->last_position_scale &&
+				(*(sg->control_type) == 0 || *(sg->velocity_cmd) == 0))
+			{
+				(*cards[card_index].stepgen_skipped)++;
+				continue;
+			}
+			sg->cache_valid = true;
+			sg->last_control_type = *(sg->control_type);
+			sg->last_pos_cmd = *(sg->pos_cmd);
+			sg->last_velocity_cmd = *(sg->velocity_cmd);
+			sg->last_position_scale = sg->positionScale;
+			(*cards[card_index].stepgen_evaluated)++;
+
 			*(sg->dir) = (*(sg->pos_cmd) >= 0);
 			*(sg->velocity_fb) = *(sg->velocity_cmd);
 
@@ -256,11 +372,21 @@ static void read(void *arg, long period_nsec)
 			*(sg->in_not) = !(*(sg->in));
 		}
 
-		// Analog Input
+		// Analog Input, the ADC only delivers a new value every adc_update_ns
+		bool adc_sample = true;
+		if (cards[card_index].adc_update_ns && *(cards[card_index].adc_update_ns) > 0)
+		{
+			cards[card_index].adc_elapsed_ns += period_nsec;
+			adc_sample = (cards[card_index].adc_elapsed_ns >= (long)*(cards[card_index].adc_update_ns));
+			if (adc_sample)
+				cards[card_index].adc_elapsed_ns %= (long)*(cards[card_index].adc_update_ns);
+		}
 		for (int i = 0; i < cards[card_index].config.num_analog_in; i++)
 		{
 			analog_in_t *sg = &cards[card_index].analog_inputs[i];
-			*(sg->in) = *(sg->in_sim);
+			double value = *(sg->in_sim) + sim_signal_next(&sg->signal, threat_cycle_time);
+			if (adc_sample)
+				*(sg->in) = adc_quantize(&cards[card_index], value);
 		}
 		// PWM
 		for (int i = 0; i < cards[card_index].config.num_pwm; i++)
@@ -273,11 +399,46 @@ static void read(void *arg, long period_nsec)
 		// card specific updates
 		if (strcmp(cards[card_index].board_type, "7i76") == 0)
 		{
-			**field_voltage = **field_voltage_sim;
+			double value = **field_voltage_sim + sim_signal_next(field_voltage_signal, threat_cycle_time);
+			if (adc_sample)
+				**field_voltage = adc_quantize(&cards[card_index], value);
 		}
 	}
 }
 
+// parameters of the simulation which the real card does not have
+
+static int sim_signal_export(sim_signal_t *sig, const char *prefix, uint32_t seed)
+{
+	char name[128]; // needed for hal_helpers, fits prefix and suffix
+	HAL_PARAM_U32(sig->waveform, prefix, "-sim-waveform", HAL_RW, comp_id);
+	HAL_PARAM_FLOAT(sig->amplitude, prefix, "-sim-amplitude", HAL_RW, comp_id);
+	HAL_PARAM_FLOAT(sig->frequency, prefix, "-sim-frequency", HAL_RW, comp_id);
+	HAL_PARAM_FLOAT(sig->noise, prefix, "-sim-noise", HAL_RW, comp_id);
+	sim_signal_init(sig, seed);
+	return 0;
+}
+
+static int stepgen_stats_export(card_t *card, const char *prefix)
+{
+	char name[128]; // needed for hal_helpers, fits prefix and suffix
+	// number of stepgen updates calculated/skipped as inputs were unchanged
+	HAL_PARAM_U32(card->stepgen_evaluated, prefix, ".stepgen.evaluated", HAL_RO, comp_id);
+	HAL_PARAM_U32(card->stepgen_skipped, prefix, ".stepgen.skipped", HAL_RO, comp_id);
+	return 0;
+}
+
+static int adc_export(card_t *card, const char *prefix)
+{
+	char name[128]; // needed for hal_helpers, fits prefix and suffix
+	HAL_PARAM_U32(card->adc_bits, prefix, ".adc-bits", HAL_RW, comp_id);
+	HAL_PARAM_FLOAT(card->adc_full_scale, prefix, ".adc-full-scale", HAL_RW, comp_id);
+	HAL_PARAM_U32(card->adc_update_ns, prefix, ".adc-update-ns", HAL_RW, comp_id);
+	*(card->adc_full_scale) = 36.0;
+	card->adc_elapsed_ns = 0;
+	return 0;
+}
+
 int configure_card(const int index)
 {
 	char name[64]; // needed for hal_helpers
@@ -309,6 +470,19 @@ int configure_card(const int index)
 
 	HAL_PIN_FLOAT_STRUCT_ARRAY(cards[index].analog_inputs, in, cards[index].config.num_analog_in, cards[index].identifier, ".analogin%01d", HAL_OUT, comp_id);
 	HAL_PIN_FLOAT_STRUCT_ARRAY(cards[index].analog_inputs, in_sim, cards[index].config.num_analog_in, cards[index].identifier, ".analogin%01d-sim", HAL_IN, comp_id);
+	for (int i = 0; i < cards[index].config.num_analog_in; i++)
+	{
+		char prefix[96];
+		snprintf(prefix, sizeof(prefix), "%s.analogin%01d", cards[index].identifier, i);
+		if (sim_signal_export(&cards[index].analog_inputs[i].signal, prefix, 0x9E3779B9u * (uint32_t)(i + 1)) != 0)
+			return -ENOMEM;
+	}
+	// one ADC per card, on the 7i76 it also measures the field voltage
+	if (cards[index].config.num_analog_in > 0 || strcmp(cards[index].board_type, "7i76") == 0)
+	{
+		if (adc_export(&cards[index], cards[index].identifier) != 0)
+			return -ENOMEM;
+	}
 
 	// Encoders
 	if (strcmp(cards[index].board_type, "7i76") == 0)
@@ -373,6 +547,11 @@ int configure_card(const int index)
 	HAL_PARAM_U32_STRUCT_ARRAY(cards[index].step_gen, stepType, cards[index].config.num_stepgens, cards[index].identifier, ".stepgen.%02d.step_type", HAL_RW, comp_id);
 	HAL_PARAM_FLOAT_STRUCT_ARRAY(cards[index].step_gen, maxAcceleration, cards[index].config.num_stepgens, cards[index].identifier, ".stepgen.%02d.maxaccel", HAL_RW, comp_id);
 	HAL_PARAM_FLOAT_STRUCT_ARRAY(cards[index].step_gen, maxVelocity, cards[index].config.num_stepgens, cards[index].identifier, ".stepgen.%02d.maxvel", HAL_RW, comp_id);
+	if (cards[index].config.num_stepgens > 0)
+	{
+		if (stepgen_stats_export(&cards[index], cards[index].identifier) != 0)
+			return -ENOMEM;
+	}
 
 	// PWM
 	HAL_PIN_FLOAT_STRUCT_ARRAY(cards[index].pwm, pwm_val, cards[index].config.num_pwm, cards[index].identifier, ".pwmgen.%02d.value", HAL_IN, comp_id);
@@ -406,6 +585,16 @@ int configure_card(const int index)
 	{
 		HAL_PIN_FLOAT(field_voltage, cards[index].identifier, ".fieldvoltage", HAL_OUT, comp_id);
 		HAL_PIN_FLOAT(field_voltage_sim, cards[index].identifier, ".fieldvoltage-sim", HAL_IN, comp_id);
+
+		field_voltage_signal = hal_malloc(sizeof(sim_signal_t));
+		if (!field_voltage_signal)
+			return -ENOMEM;
+		memset(field_voltage_signal, 0, sizeof(sim_signal_t));
+
+		char prefix[96];
+		snprintf(prefix, sizeof(prefix), "%s.fieldvoltage", cards[index].identifier);
+		if (sim_signal_export(field_voltage_signal, prefix, 0x2545F491u) != 0)
+			return -ENOMEM;
 	}
 }
 
@@ -431,7 +620,7 @@ int rtapi_app_main(void)
 		return comp_id;
 
 	num_cards = 2; // or from config/environment
-	cards = malloc(sizeof(card_t) * num_cards);
+	cards = calloc(num_cards, sizeof(card_t));
 	if (!cards)
 	{
 		fprintf(stderr, "Failed to allocate memory for cards\n");